@@ -0,0 +1,84 @@
+///************************* ITELMA SP ****************************************
+
+// Benchmark of resolving from a shared container with and without NUMA replication.
+// Threads are bound round-robin to NUMA nodes, so on a multi-socket host half of them
+// resolve from a remote container unless it is replicated. Works on one-node hosts too.
+// usage: IoCBenchmark [threads] [resolves per thread]
+
+#include "ioc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+enum { SCOPES = 100, METHODS = 100 };
+
+static int value = 42;
+static int* GetValue() { return &value; }
+
+static std::vector<std::string> scopes, names;
+
+static double run(IoC& ioc, int threadCount, int resolves)
+{
+  const cNumaTopology& topology = cNumaTopology::Get();
+  std::atomic<bool> go{ false };
+  std::atomic<long long> sum{ 0 };
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < threadCount; ++i)
+  {
+    threads.emplace_back([&, i]()
+      {
+        topology.PinThread(i % topology.NodeCount());
+        while (!go.load())
+          std::this_thread::yield();
+
+        long long s = 0;
+        for (int j = 0; j < resolves; ++j)
+        {
+          s += *ioc.Resolve<int>(scopes[(i + j) % SCOPES], names[j % METHODS]);
+        }
+        sum += s;
+      });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  go.store(true);
+  for (auto& thread : threads)
+    thread.join();
+  auto finish = std::chrono::steady_clock::now();
+
+  if (sum.load() != 42LL * threadCount * resolves)
+    std::printf("wrong result\n");
+
+  return std::chrono::duration<double, std::nano>(finish - start).count() / (double(threadCount) * resolves);
+}
+
+int main(int argc, char* argv[])
+{
+  const cNumaTopology& topology = cNumaTopology::Get();
+  int threadCount = argc > 1 ? std::atoi(argv[1]) : int(std::thread::hardware_concurrency());
+  int resolves = argc > 2 ? std::atoi(argv[2]) : 1'000'000;
+  if (threadCount <= 0)
+    threadCount = 1;
+
+  for (int j = 0; j < METHODS; ++j)
+    names.push_back("method" + std::to_string(j));
+
+  IoC ioc;
+  for (int i = 0; i < SCOPES; ++i)
+  {
+    scopes.push_back("scope" + std::to_string(i));
+    cFactory f;
+    for (const auto& name : names)
+      f.Register(name, GetValue);
+    const cFactory& f1 = f;
+    std::unique_ptr<iCommand>(ioc.Resolve<iCommand>("Register", scopes.back(), f1))->Execute();
+  }
+
+  std::printf("nodes: %d, threads: %d, resolves per thread: %d\n", topology.NodeCount(), threadCount, resolves);
+  std::printf("shared:     %.1f ns per resolve\n", run(ioc, threadCount, resolves));
+  ioc.EnableReplication();
+  std::printf("replicated: %.1f ns per resolve\n", run(ioc, threadCount, resolves));
+  return 0;
+}
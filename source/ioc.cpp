@@ -1,3 +1,880 @@
 ///************************* ITELMA SP ****************************************
 
 #include "ioc.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/membarrier.h>
+#endif
+
+static const char registryIndexMagic[8] = { 'I', 'o', 'C', 'I', 'D', 'X', '1', '\0' };
+
+cRegistryIndex::~cRegistryIndex()
+{
+  reset();
+}
+
+void cRegistryIndex::reset()
+{
+#ifndef _WIN32
+  if (data != nullptr && buffer.empty())
+    munmap(const_cast<char*>(data), length);
+#endif
+  data = nullptr;
+  length = 0;
+  count = 0;
+  buffer.clear();
+}
+
+void cRegistryIndex::Save(const std::string& path, const std::map<std::string, cFactory>& factories,
+  const std::vector<const void*>& slots)
+{
+  std::map<const void*, std::uint32_t> slotOf;
+  for (std::size_t i = 0; i < slots.size(); ++i)
+    slotOf.emplace(slots[i], std::uint32_t(i));
+
+  // both maps are ordered, so entries come sorted by scope and name
+  std::vector<cEntry> entries;
+  std::string strings;
+  for (const auto& [scope, factory] : factories)
+  {
+    std::uint32_t scopeOff = std::uint32_t(strings.size());
+    strings += scope;
+    for (const auto& [objName, f] : factory.factoryMethods)
+    {
+      auto it = slotOf.find(f);
+      if (it == slotOf.end())
+        throw cException("There isn't such factory method in the slot table.");
+
+      entries.push_back({ scopeOff, std::uint32_t(scope.size()), std::uint32_t(strings.size()),
+        std::uint32_t(objName.size()), it->second });
+      strings += objName;
+    }
+  }
+
+  cHeader header{};
+  std::memcpy(header.magic, registryIndexMagic, sizeof(header.magic));
+  header.count = std::uint32_t(entries.size());
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(cEntry)));
+  out.write(strings.data(), std::streamsize(strings.size()));
+  if (!out)
+    throw cException("Can't write registry index.");
+}
+
+void cRegistryIndex::Open(const std::string& path)
+{
+  reset();
+
+#ifdef _WIN32
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw cException("Can't read registry index.");
+  buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  data = buffer.data();
+  length = buffer.size();
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw cException("Can't read registry index.");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(cHeader)))
+  {
+    close(fd);
+    throw cException("Wrong registry index.");
+  }
+
+  void* p = mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    throw cException("Can't read registry index.");
+
+  data = static_cast<const char*>(p);
+  length = std::size_t(st.st_size);
+#endif
+
+  // a wrong file leaves the index empty
+  cHeader header;
+  if (length < sizeof(header))
+  {
+    reset();
+    throw cException("Wrong registry index.");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, registryIndexMagic, sizeof(header.magic)) != 0
+    || (length - sizeof(header)) / sizeof(cEntry) < header.count)
+  {
+    reset();
+    throw cException("Wrong registry index.");
+  }
+
+  count = header.count;
+}
+
+const cRegistryIndex::cEntry& cRegistryIndex::entry(std::uint32_t i) const
+{
+  return reinterpret_cast<const cEntry*>(data + sizeof(cHeader))[i];
+}
+
+std::string_view cRegistryIndex::text(std::uint32_t off, std::uint32_t len) const
+{
+  // strings are checked on use, so opening doesn't touch every page
+  std::size_t begin = sizeof(cHeader) + std::size_t(count) * sizeof(cEntry);
+  if (std::size_t(off) + len > length - begin)
+    throw cException("Wrong registry index.");
+  return std::string_view(data + begin + off, len);
+}
+
+int cRegistryIndex::Find(std::string_view scope, std::string_view objName, bool* scopeFound) const
+{
+  // lower bound by (scope, objName)
+  std::uint32_t lo = 0, hi = count;
+  while (lo < hi)
+  {
+    std::uint32_t mid = lo + (hi - lo) / 2;
+    const cEntry& e = entry(mid);
+    int c = text(e.scopeOff, e.scopeLen).compare(scope);
+    if (c == 0)
+      c = text(e.nameOff, e.nameLen).compare(objName);
+    if (c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // the scope is either at the bound or just before it
+  bool atBound = lo < count && text(entry(lo).scopeOff, entry(lo).scopeLen) == scope;
+  if (scopeFound != nullptr)
+    *scopeFound = atBound || (lo > 0 && text(entry(lo - 1).scopeOff, entry(lo - 1).scopeLen) == scope);
+  if (!atBound)
+    return -1;
+
+  const cEntry& e = entry(lo);
+  return text(e.nameOff, e.nameLen) == objName ? int(e.slot) : -1;
+}
+
+void cRegistryIndex::ForEach(const std::function<void(std::string_view, std::string_view, int)>& f) const
+{
+  for (std::uint32_t i = 0; i < count; ++i)
+  {
+    const cEntry& e = entry(i);
+    f(text(e.scopeOff, e.scopeLen), text(e.nameOff, e.nameLen), int(e.slot));
+  }
+}
+
+
+cCommandExecutor::cCommandExecutor(std::size_t maxBatch, std::function<void()> afterBatch,
+  std::function<void()> beforeBatch)
+  : maxBatch(maxBatch == 0 ? 1 : maxBatch), afterBatch(std::move(afterBatch)), beforeBatch(std::move(beforeBatch))
+{
+  tail = new cNode;
+  head.store(tail);
+  writer = std::thread(&cCommandExecutor::run, this);
+}
+
+cCommandExecutor::~cCommandExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lk(m);
+    stop.store(true);
+  }
+  cv.notify_one();
+  writer.join();
+  delete tail;
+}
+
+std::future<void> cCommandExecutor::Push(std::unique_ptr<iCommand> command)
+{
+  cNode* node = new cNode;
+  node->command = std::move(command);
+  std::future<void> res = node->done.get_future();
+
+  cNode* prev = head.exchange(node);
+  prev->next.store(node, std::memory_order_release);
+
+  // take the mutex only if the writer sleeps
+  if (waiting.load())
+  {
+    std::lock_guard<std::mutex> lk(m);
+  }
+  cv.notify_one();
+  return res;
+}
+
+void cCommandExecutor::Flush()
+{
+  Push(nullptr).get();
+}
+
+std::size_t cCommandExecutor::drain(std::vector<cItem>& batch)
+{
+  batch.clear();
+  while (batch.size() < maxBatch)
+  {
+    cNode* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+    {
+      if (head.load() == tail)
+        break;                   // empty
+      std::this_thread::yield(); // a producer hasn't linked its node yet
+      continue;
+    }
+
+    // the next node becomes the stub, its content goes to the batch
+    batch.emplace_back();
+    batch.back().command = std::move(next->command);
+    batch.back().done = std::move(next->done);
+    delete tail;
+    tail = next;
+  }
+  return batch.size();
+}
+
+void cCommandExecutor::run()
+{
+  std::vector<cItem> batch, unpublished;
+  batch.reserve(maxBatch);
+  std::size_t batches = 0;
+
+  for (;;)
+  {
+    if (drain(batch) != 0)
+    {
+      {
+        std::unique_lock<std::shared_mutex> lk(guard);
+        std::exception_ptr failed; // the batch isn't executed if beforeBatch fails
+        try
+        {
+          if (beforeBatch)
+            beforeBatch();
+        }
+        catch (...)
+        {
+          failed = std::current_exception();
+        }
+
+        for (auto& item : batch)
+        {
+          try
+          {
+            if (failed)
+              item.error = failed;
+            else if (item.command)
+              item.command->Execute();
+          }
+          catch (...)
+          {
+            item.error = std::current_exception();
+          }
+        }
+      }
+      for (auto& item : batch)
+        unpublished.push_back(std::move(item));
+
+      // publish when the queue is empty or every publishEvery batches under steady load
+      if (++batches < publishEvery && head.load() != tail)
+        continue;
+      batches = 0;
+
+      // the writer is the only thread changing the state, so it can publish outside the lock
+      if (afterBatch)
+      {
+        try
+        {
+          afterBatch();
+        }
+        catch (...)
+        {
+          for (auto& item : unpublished)
+            if (!item.error)
+              item.error = std::current_exception();
+        }
+      }
+
+      // complete after publication, so a waiting caller reads its writes
+      for (auto& item : unpublished)
+      {
+        if (item.error)
+          item.done.set_exception(std::move(item.error));
+        else
+          item.done.set_value();
+      }
+      unpublished.clear();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(m);
+    waiting.store(true);
+    cv.wait(lk, [this] { return stop.load() || head.load() != tail; });
+    waiting.store(false);
+    if (stop.load() && head.load() == tail)
+      break;
+  }
+}
+
+
+cThreadPool::cThreadPool(std::size_t count)
+{
+  if (count == 0)
+    count = 1;
+  for (std::size_t i = 0; i < count; ++i)
+    threads.emplace_back(&cThreadPool::work, this);
+}
+
+cThreadPool::~cThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lk(m);
+    stop = true;
+  }
+  cv.notify_all();
+  for (auto& t : threads)
+    t.join();
+}
+
+void cThreadPool::Run(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lk(m);
+    tasks.push_back(std::move(task));
+  }
+  cv.notify_one();
+}
+
+void cThreadPool::work()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lk(m);
+      cv.wait(lk, [this] { return stop || !tasks.empty(); });
+      if (tasks.empty())
+        break; // stopped and nothing left
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+
+// parse a CPU list like "0-3,8,10-11"
+static std::vector<int> parseCpuList(const std::string& s)
+{
+  std::vector<int> res;
+  std::istringstream in(s);
+  std::string range;
+  while (std::getline(in, range, ','))
+  {
+    if (range.empty() || range == "\n")
+      continue;
+    try
+    {
+      std::size_t dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu)
+        res.push_back(cpu);
+    }
+    catch (const std::exception&) // not a number, skip it
+    {
+    }
+  }
+  return res;
+}
+
+cNumaTopology::cNumaTopology(const std::string& sysfsNodeDir)
+{
+  std::error_code ec;
+  for (std::filesystem::directory_iterator it(sysfsNodeDir, ec), end; !ec && it != end; it.increment(ec))
+  {
+    const std::string name = it->path().filename().string();
+    if (name.size() <= 4 || name.compare(0, 4, "node") != 0
+      || name.find_first_not_of("0123456789", 4) != std::string::npos)
+      continue;
+
+    std::size_t node = std::stoul(name.substr(4));
+    std::ifstream in(it->path() / "cpulist");
+    std::string list;
+    std::getline(in, list);
+
+    if (nodeCpus.size() <= node)
+      nodeCpus.resize(node + 1);
+    nodeCpus[node] = parseCpuList(list);
+  }
+
+  // no NUMA information: one node with every CPU
+  if (nodeCpus.empty())
+  {
+    unsigned n = std::thread::hardware_concurrency();
+    nodeCpus.resize(1);
+    for (unsigned cpu = 0; cpu < (n == 0 ? 1 : n); ++cpu)
+      nodeCpus[0].push_back(int(cpu));
+  }
+
+  for (std::size_t node = 0; node < nodeCpus.size(); ++node)
+  {
+    for (int cpu : nodeCpus[node])
+    {
+      if (cpuNode.size() <= std::size_t(cpu))
+        cpuNode.resize(std::size_t(cpu) + 1, 0);
+      cpuNode[cpu] = int(node);
+    }
+  }
+}
+
+const cNumaTopology& cNumaTopology::Get()
+{
+  static const cNumaTopology topology;
+  return topology;
+}
+
+int cNumaTopology::NodeOfCpu(int cpu) const
+{
+  return cpu >= 0 && std::size_t(cpu) < cpuNode.size() ? cpuNode[cpu] : 0;
+}
+
+int cNumaTopology::CurrentNode() const
+{
+#ifdef __linux__
+  if (nodeCpus.size() > 1)
+    return NodeOfCpu(sched_getcpu());
+#endif
+  return 0;
+}
+
+bool cNumaTopology::PreferNode(int node) const
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  if (node < 0 || node >= NodeCount())
+    return false;
+
+  unsigned long mask[16] = {};
+  const std::size_t bits = sizeof(mask[0]) * 8;
+  if (std::size_t(node) >= bits * 16)
+    return false;
+  mask[node / bits] = 1ul << (node % bits);
+  return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, bits * 16) == 0;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
+bool cNumaTopology::PinThread(int node) const
+{
+#ifdef __linux__
+  if (node < 0 || node >= NodeCount() || nodeCpus[node].empty())
+    return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : nodeCpus[node])
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
+// Epochs of readers of replicas.
+// A reader announces the current epoch in its own record for the time of reading, 0 means
+// it doesn't read. A publisher replaces copies, then advances the epoch: readers announced
+// after that take the new copies, the old ones are freed when every active reader has a
+// later epoch. Records are never freed, a record of a finished thread is reused.
+struct alignas(64) cReaderRecord
+{
+  std::atomic<std::uint64_t> epoch{ 0 };
+  unsigned depth = 0;            // nested reader scopes of the owner thread
+  std::atomic<bool> used{ true };
+  cReaderRecord* next = nullptr;
+};
+
+static std::atomic<cReaderRecord*> readerRecords{ nullptr };
+static std::atomic<std::uint64_t> readerEpoch{ 1 };
+
+// true if the publisher can fence every reader by membarrier, readers don't need own fences then
+static bool registerMembarrier()
+{
+#if defined(__linux__) && defined(SYS_membarrier)
+  static const bool registered = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+  return registered;
+#else
+  return false;
+#endif
+}
+
+static cReaderRecord& thisThreadReader()
+{
+  struct cHolder
+  {
+    cHolder()
+    {
+      for (rec = readerRecords.load(std::memory_order_acquire); rec != nullptr; rec = rec->next)
+      {
+        bool unused = false;
+        if (rec->used.compare_exchange_strong(unused, true))
+          return;
+      }
+
+      rec = new cReaderRecord;
+      rec->next = readerRecords.load();
+      while (!readerRecords.compare_exchange_weak(rec->next, rec))
+        ;
+    }
+
+    ~cHolder()
+    {
+      rec->epoch.store(0, std::memory_order_release);
+      rec->depth = 0;
+      rec->used.store(false);
+    }
+
+    cReaderRecord* rec;
+  };
+
+  thread_local cHolder holder;
+  return *holder.rec;
+}
+
+cReplicas::cReader::cReader(const cReplicas& replicas)
+{
+  cReaderRecord& rec = thisThreadReader();
+  if (rec.depth++ == 0)
+  {
+    rec.epoch.store(readerEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // the announcement must be visible before the copy is read (paired with reclaim)
+    if (replicas.membarrier)
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    else
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  std::size_t node = std::size_t(cNumaTopology::Get().CurrentNode());
+  if (node >= replicas.slots.size())
+    node = 0;
+  factories = replicas.slots[node]->current.load(std::memory_order_acquire);
+}
+
+cReplicas::cReader::~cReader()
+{
+  cReaderRecord& rec = thisThreadReader();
+  if (--rec.depth == 0)
+    rec.epoch.store(0, std::memory_order_release);
+}
+
+// long-lived builder thread of a node
+struct cReplicas::cNode
+{
+  explicit cNode(int node) : builder(&cNode::run, this, node)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk, [this] { return slot != nullptr; });
+  }
+
+  ~cNode()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m);
+      stop = true;
+    }
+    cv.notify_all();
+    builder.join();
+  }
+
+  void Post(const tFactories* factories)
+  {
+    {
+      std::lock_guard<std::mutex> lk(m);
+      source = factories;
+    }
+    cv.notify_all();
+  }
+
+  // copy made by the builder, throw if it has failed
+  const tFactories* Wait()
+  {
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk, [this] { return source == nullptr; });
+    if (error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+    return std::exchange(built, nullptr);
+  }
+
+  void run(int node)
+  {
+    const cNumaTopology& topology = cNumaTopology::Get();
+    topology.PinThread(node);
+    topology.PreferNode(node);
+
+    std::unique_lock<std::mutex> lk(m);
+    slot = new cSlot;
+    cv.notify_all();
+
+    for (;;)
+    {
+      cv.wait(lk, [this] { return stop || source != nullptr; });
+      if (stop)
+        break;
+
+      try
+      {
+        built = new tFactories(*source);
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      source = nullptr;
+      cv.notify_all();
+    }
+  }
+
+  std::mutex m;
+  std::condition_variable cv;
+  cSlot* slot = nullptr;
+  const tFactories* source = nullptr;
+  const tFactories* built = nullptr;
+  std::exception_ptr error;
+  bool stop = false;
+  std::thread builder; // the last member: it starts in the constructor
+};
+
+cReplicas::cReplicas() : membarrier(registerMembarrier())
+{
+  const int n = cNumaTopology::Get().NodeCount();
+  for (int node = 0; node < n; ++node)
+  {
+    nodes.push_back(std::make_unique<cNode>(node));
+    slots.push_back(nodes.back()->slot);
+  }
+}
+
+cReplicas::~cReplicas()
+{
+  nodes.clear();
+  for (cSlot* slot : slots)
+  {
+    delete slot->current.load();
+    delete slot;
+  }
+  for (const auto& r : retired)
+    delete r.factories;
+}
+
+void cReplicas::Publish(const tFactories& factories)
+{
+  for (auto& node : nodes)
+    node->Post(&factories);
+
+  // wait for all builders even if one fails
+  std::vector<const tFactories*> copies;
+  std::exception_ptr error;
+  for (auto& node : nodes)
+  {
+    try
+    {
+      copies.push_back(node->Wait());
+    }
+    catch (...)
+    {
+      copies.push_back(nullptr);
+      error = std::current_exception();
+    }
+  }
+  if (error)
+  {
+    for (const tFactories* copy : copies)
+      delete copy;
+    std::rethrow_exception(error);
+  }
+
+  const std::size_t first = retired.size();
+  for (std::size_t i = 0; i < slots.size(); ++i)
+  {
+    const tFactories* old = slots[i]->current.load(std::memory_order_relaxed);
+    slots[i]->current.store(copies[i], std::memory_order_release);
+    if (old != nullptr)
+      retired.push_back({ old, 0 });
+  }
+
+  // readers announced at this epoch or earlier may hold the old copies
+  const std::uint64_t epoch = readerEpoch.fetch_add(1);
+  for (std::size_t i = first; i < retired.size(); ++i)
+    retired[i].epoch = epoch;
+
+  reclaim();
+}
+
+void cReplicas::reclaim()
+{
+  // paired with the fence of readers: either a reader is seen here or it reads the new copy
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+#if defined(__linux__) && defined(SYS_membarrier)
+  if (membarrier)
+    syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+#endif
+
+  std::uint64_t oldest = UINT64_MAX;
+  for (cReaderRecord* rec = readerRecords.load(std::memory_order_acquire); rec != nullptr; rec = rec->next)
+  {
+    std::uint64_t epoch = rec->epoch.load(std::memory_order_acquire);
+    if (epoch != 0 && epoch < oldest)
+      oldest = epoch;
+  }
+
+  auto it = std::remove_if(retired.begin(), retired.end(), [oldest](const cRetired& r)
+    {
+      if (r.epoch >= oldest)
+        return false;
+      delete r.factories;
+      return true;
+    });
+  retired.erase(it, retired.end());
+}
+
+cMemoCache::cMemoCache(const cMemoPolicy& policy) : policy(policy)
+{
+  std::size_t n = policy.shards == 0 ? 1 : policy.shards;
+  maxEntries = policy.maxEntries / n == 0 ? 1 : policy.maxEntries / n;
+  memoryBudget = policy.memoryBudget / n;
+  for (std::size_t i = 0; i < n; ++i)
+    shards.emplace_back(new cShard);
+}
+
+bool cMemoCache::find(std::size_t hash, const std::function<bool(const std::any&)>& equal, void*& result)
+{
+  cShard& shard = *shards[hash % shards.size()];
+  std::lock_guard<std::mutex> lk(shard.m);
+
+  auto range = shard.entries.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    if (equal(it->second->args))
+    {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      result = it->second->result;
+      shard.hits.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  shard.misses.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+cMemoCache::~cMemoCache()
+{
+  for (const auto& shard : shards)
+  {
+    for (const auto& e : shard->lru)
+      if (e.deleter != nullptr)
+        e.deleter(e.result);
+    for (const auto& [result, deleter] : shard->retired)
+      deleter(result);
+  }
+}
+
+void* cMemoCache::insert(std::size_t hash, const std::function<bool(const std::any&)>& equal, std::any args,
+  void* result, std::size_t bytes, tDeleter deleter)
+{
+  std::vector<cEntry> evicted; // destroyed out of the lock
+  {
+    cShard& shard = *shards[hash % shards.size()];
+    std::lock_guard<std::mutex> lk(shard.m);
+
+    // another thread has made it meanwhile: keep the cached one
+    auto range = shard.entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+      if (equal(it->second->args))
+      {
+        if (deleter != nullptr)
+          deleter(result);
+        return it->second->result;
+      }
+    }
+
+    shard.lru.push_front({ hash, std::move(args), result, bytes, deleter });
+    shard.entries.emplace(hash, shard.lru.begin());
+    shard.bytes += bytes;
+
+    // evict least recently used entries, the new one is kept anyway
+    while (shard.lru.size() > 1 && (shard.lru.size() > maxEntries || shard.bytes > memoryBudget))
+    {
+      auto last = std::prev(shard.lru.end());
+      auto range = shard.entries.equal_range(last->hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->second == last)
+        {
+          shard.entries.erase(it);
+          break;
+        }
+      }
+      shard.bytes -= last->bytes;
+      // callers may hold an evicted result, an owned one is deleted with the cache
+      if (last->deleter != nullptr)
+        shard.retired.emplace_back(last->result, last->deleter);
+      evicted.push_back(std::move(*last));
+      shard.lru.erase(last);
+      shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  return result;
+}
+
+std::size_t cMemoCache::count(std::atomic<std::size_t> cShard::* counter) const
+{
+  std::size_t res = 0;
+  for (const auto& shard : shards)
+    res += ((*shard).*counter).load(std::memory_order_relaxed);
+  return res;
+}
+
+std::size_t cMemoCache::Size() const
+{
+  std::size_t res = 0;
+  for (const auto& shard : shards)
+  {
+    std::lock_guard<std::mutex> lk(shard->m);
+    res += shard->lru.size();
+  }
+  return res;
+}
+
+std::size_t cMemoCache::MemoryUsage() const
+{
+  std::size_t res = 0;
+  for (const auto& shard : shards)
+  {
+    std::lock_guard<std::mutex> lk(shard->m);
+    res += shard->bytes;
+  }
+  return res;
+}
@@ -7,6 +7,21 @@
 #include <functional>
 #include <map>
 #include <stdexcept>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <any>
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <shared_mutex>
+#include <list>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <deque>
 
 // cIoC-container
 // with only entry
@@ -20,6 +35,8 @@
 
 class cIoC;
 class cFactory;
+class cRegistryIndex;
+class cMemoCache;
 
 // interface class of command
 class iCommand
@@ -71,11 +88,245 @@ struct iRegisterFactoryMethod : public iCommand
 };
 
 
+// Asynchronous executor of commands.
+// Producers Push commands from any thread into a lock-free multi-producer queue. A single
+// writer thread drains the queue in batches and executes a whole batch under one exclusive
+// lock of the guard, so threads resolving under ReadLock() see either all of a batch or
+// nothing of it. Push returns a future which is ready when the command has been executed
+// (with the exception thrown by Execute, if any). Flush waits for every command pushed before it.
+// cIoC t; cCommandExecutor e;
+// e.Push(std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "ScopeName", f)));
+// e.Flush();
+// { auto lock = e.ReadLock(); t.Resolve<ObjType>("ScopeName", "get int for me", 42); }
+// beforeBatch is called by the writer thread before every batch and afterBatch after a batch
+// when the queue is empty (and at least every 16 batches under steady load), before the futures
+// of the batches are ready, e.g. to publish replicas of a container once for several batches
+// (see cIoC::DeferReplicas).
+// Commands mustn't be pushed while the executor is being destroyed.
+class cCommandExecutor
+{
+public:
+  explicit cCommandExecutor(std::size_t maxBatch = 64, std::function<void()> afterBatch = nullptr,
+    std::function<void()> beforeBatch = nullptr);
+  ~cCommandExecutor(); // executes the rest of commands and stops the writer thread
+
+  std::future<void> Push(std::unique_ptr<iCommand> command);
+  void Flush();
+
+  std::shared_lock<std::shared_mutex> ReadLock() const { return std::shared_lock<std::shared_mutex>(guard); }
+
+protected:
+  struct cNode
+  {
+    std::atomic<cNode*> next{ nullptr };
+    std::unique_ptr<iCommand> command; // nullptr is a barrier
+    std::promise<void> done;
+  };
+
+  struct cItem
+  {
+    std::unique_ptr<iCommand> command;
+    std::promise<void> done;
+    std::exception_ptr error;
+  };
+
+  enum { publishEvery = 16 }; // batches executed before afterBatch under steady load
+
+  void run();
+  std::size_t drain(std::vector<cItem>& batch);
+
+protected:
+  const std::size_t maxBatch;
+  const std::function<void()> afterBatch;
+  const std::function<void()> beforeBatch;
+  std::atomic<cNode*> head;        // last pushed node, producers' side
+  cNode* tail;                     // stub node, writer's side
+  mutable std::shared_mutex guard; // exclusive per batch
+  std::mutex m;                    // only to sleep/wake the writer
+  std::condition_variable cv;
+  std::atomic<bool> waiting{ false };
+  std::atomic<bool> stop{ false };
+  std::thread writer;
+
+private:
+  cCommandExecutor(const cCommandExecutor&) = delete;
+  cCommandExecutor& operator=(const cCommandExecutor&) = delete;
+};
+
+// Bounded pool of threads running tasks in order of submission (the default executor of
+// cIoC::ResolveAsync). Tasks mustn't throw. The destructor runs the rest of the tasks and
+// joins the threads.
+class cThreadPool
+{
+public:
+  explicit cThreadPool(std::size_t count = std::thread::hardware_concurrency());
+  ~cThreadPool();
+
+  void Run(std::function<void()> task);
+
+protected:
+  void work();
+
+protected:
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> tasks;
+  bool stop = false;
+  std::vector<std::thread> threads;
+
+private:
+  cThreadPool(const cThreadPool&) = delete;
+  cThreadPool& operator=(const cThreadPool&) = delete;
+};
+
+// Hash of an argument of a memoized factory method.
+// It uses std::hash, specialize it for own types:
+// template<> struct cMemoHash<MyType> { std::size_t operator()(const MyType&) const; };
+// Types without a hash (or operator==) can't be arguments of a memoized factory method.
+template<typename T, typename = void>
+struct cMemoHash
+{
+};
+
+template<typename T>
+struct cMemoHash<T, std::void_t<decltype(std::hash<T>()(std::declval<const T&>()))>>
+{
+  std::size_t operator()(const T& v) const { return std::hash<T>()(v); }
+};
+
+// policy of memoization of a factory method
+struct cMemoPolicy
+{
+  std::size_t maxEntries = 1024;        // entries of the cache
+  std::size_t memoryBudget = 1 << 20;   // estimated bytes of the cache
+  std::size_t shards = 8;               // shards with own lock and LRU list
+  bool ownsResults = false;             // the cache deletes results, see cMemoCache
+};
+
+// Bounded concurrent cache of results of a factory method keyed by argument values.
+// Keys are hashes of argument packs, the values are kept to tell collisions apart.
+// Every shard has own mutex and LRU list, the limits of the policy are split between shards.
+// Results are shared by every caller with the same arguments, so callers mustn't delete them.
+// By default the factory method keeps ownership of results (e.g. it returns interned objects).
+// If the policy ownsResults the cache deletes them when it is destroyed, evicted results are
+// kept until then, as callers may still hold them. So the budget bounds cached entries only.
+// The container keeps dropped caches owning results until it is destroyed itself.
+class cMemoCache
+{
+public:
+  explicit cMemoCache(const cMemoPolicy& policy);
+  ~cMemoCache(); // deletes owned results, evicted ones too
+
+  // result of the factory method for the arguments, the method is called on a miss only
+  template< typename T, typename... Params, typename... Args>
+  T* Resolve(T* (*method)(Params...), Args&&... args)
+  {
+    using tKey = std::tuple<std::decay_t<Params>...>;
+    tKey key(std::forward<Args>(args)...);
+    const std::size_t hash = std::apply([](const auto&... a) { return hashOf(a...); }, key);
+
+    auto equal = [&key](const std::any& a) { const tKey* k = std::any_cast<tKey>(&a); return k != nullptr && *k == key; };
+    void* res;
+    if (find(hash, equal, res))
+      return static_cast<T*>(res);
+
+    T* created = std::apply(method, key);
+    const std::size_t bytes = sizeof(cEntry) + sizeof(tKey) + std::apply([](const auto&... a) { return (std::size_t(0) + ... + heapBytes(a)); }, key)
+      + (created != nullptr ? sizeof(T) + heapBytes(*created) : 0);
+    tDeleter deleter = policy.ownsResults ? +[](void* p) { delete static_cast<T*>(p); } : nullptr;
+    return static_cast<T*>(insert(hash, equal, std::any(std::move(key)), created, bytes, deleter));
+  }
+
+  const cMemoPolicy& Policy() const { return policy; }
+
+  std::size_t Hits() const { return count(&cShard::hits); }
+  std::size_t Misses() const { return count(&cShard::misses); }
+  std::size_t Evictions() const { return count(&cShard::evictions); }
+  std::size_t Size() const;
+  std::size_t MemoryUsage() const; // estimated bytes
+
+protected:
+  using tDeleter = void (*)(void*);
+
+  struct cEntry
+  {
+    std::size_t hash;
+    std::any args;    // std::tuple of argument values
+    void* result;
+    std::size_t bytes;
+    tDeleter deleter; // nullptr if the cache doesn't own the result
+  };
+
+  struct alignas(64) cShard
+  {
+    std::mutex m;
+    std::list<cEntry> lru; // most recently used first
+    std::unordered_multimap<std::size_t, std::list<cEntry>::iterator> entries;
+    std::size_t bytes = 0;
+    std::vector<std::pair<void*, tDeleter>> retired;            // evicted owned results
+    std::atomic<std::size_t> hits{ 0 }, misses{ 0 }, evictions{ 0 }; // relaxed
+  };
+
+  std::size_t count(std::atomic<std::size_t> cShard::* counter) const;
+
+  template<typename... Args>
+  static std::size_t hashOf(const Args&... args)
+  {
+    std::size_t seed = sizeof...(Args);
+    ((seed ^= cMemoHash<Args>()(args) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)), ...);
+    return seed;
+  }
+
+  template<typename A>
+  static std::size_t heapBytes(const A&) { return 0; }
+  static std::size_t heapBytes(const std::string& s) { return s.capacity(); }
+
+  bool find(std::size_t hash, const std::function<bool(const std::any&)>& equal, void*& result);
+  // returns the result to use: an equal entry may have been inserted by another thread
+  void* insert(std::size_t hash, const std::function<bool(const std::any&)>& equal, std::any args, 
+    void* result, std::size_t bytes, tDeleter deleter);
+
+protected:
+  const cMemoPolicy policy;
+  std::size_t maxEntries, memoryBudget;        // per shard
+  std::vector<std::unique_ptr<cShard>> shards;
+};
+
+// true if an argument of the type can be memoized: it has cMemoHash and operator==
+template<typename T, typename = void>
+struct cIsMemoizable : std::false_type
+{
+};
+
+template<typename T>
+struct cIsMemoizable<T, std::enable_if_t<std::is_invocable_r_v<std::size_t, cMemoHash<T>, const T&>
+  && std::is_convertible_v<decltype(std::declval<const T&>() == std::declval<const T&>()), bool>>> : std::true_type
+{
+};
+
+struct iRegisterMemoization : public iCommand
+{
+  iRegisterMemoization(cIoC& ioc, const std::string& scope, const std::string& objName, const cMemoPolicy& policy)
+    : ioc(&ioc), scope(scope), objName(objName), policy(policy) {}
+
+  void Execute() override;
+
+  const char* Type()  override { return typeid(*this).name(); }
+
+  cIoC* ioc;
+  const std::string scope, objName;
+  const cMemoPolicy policy;
+};
+
 // Factory 
 // keep factory methond in a map<string,function pointer>
 class cFactory
 {
+  friend class cIoC;
+  friend struct iRegisterFactory;
   friend struct iRegisterFactoryMethod;
+  friend struct iRegisterMemoization;
+  friend class cRegistryIndex;
 
 public:
   template< typename T, typename... Args>
@@ -105,15 +356,189 @@ public:
 
   int size() const { return int(factoryMethods.size()); }
 
+  bool contains(const std::string& objName) const { return factoryMethods.find(objName) != factoryMethods.end(); }
+
+  // the factory is registered for a whole scope, so it hides the scope of a registry index
+  bool replacesIndex() const { return wholeScope; }
+
+  // memoization cache of a factory method or nullptr
+  std::shared_ptr<cMemoCache> getMemo(const std::string& objName) const
+  {
+    if (memo.empty())
+      return nullptr;
+    auto it = memo.find(objName);
+    return it == memo.end() ? nullptr : it->second;
+  }
+
 protected:
   // keeps the pointer as old plain pointers.
   void doRegister(const std::string& objName, const void* f)
   {
     factoryMethods[objName] = f;
+
+    // results of the replaced method mustn't be returned, keep the policy only
+    auto it = memo.find(objName);
+    if (it != memo.end())
+      it->second = std::make_shared<cMemoCache>(it->second->Policy());
+  }
+
+  // the method may be registered in a registry index of the scope
+  void doMemoize(const std::string& objName, const cMemoPolicy& policy)
+  {
+    memo[objName] = std::make_shared<cMemoCache>(policy);
   }
 
 protected:
   std::map<std::string, const void*> factoryMethods;
+  std::map<std::string, std::shared_ptr<cMemoCache>> memo; // object name -> cache of a memoized method
+  bool wholeScope = false;                                 // registered by iRegisterFactory
+};
+
+// Precomputed registry index.
+// A sorted table of (scope, object name) -> slot number kept in a binary file.
+// Save writes the layout of registered factories, Open maps the file back (mmap on POSIX).
+// Slot numbers index a table of factory method pointers which is the same in every run of
+// the binary, so attaching a mapped index to a container needs no per-key allocation:
+// a lookup is a binary search over the mapped entries.
+// File: header { magic, count }, count entries { scopeOff, scopeLen, nameOff, nameLen, slot }
+// sorted by scope and name, then a blob of strings. Numbers are in native byte order.
+class cRegistryIndex
+{
+public:
+  cRegistryIndex() = default;
+  ~cRegistryIndex();
+
+  // write index of the factories. Every factory method must be in the slot table.
+  // throw cException if a method isn't in the table or the file can't be written.
+  static void Save(const std::string& path, const std::map<std::string, cFactory>& factories, 
+    const std::vector<const void*>& slots);
+
+  // map an index file instead of the opened one. throw cException if the file can't be read
+  // or isn't an index, the index is empty then.
+  void Open(const std::string& path);
+
+  // slot of a factory method or -1. scopeFound is set if there is such scope in the index.
+  int Find(std::string_view scope, std::string_view objName, bool* scopeFound = nullptr) const;
+
+  // call f(scope, objName, slot) for every entry in sorted order
+  void ForEach(const std::function<void(std::string_view, std::string_view, int)>& f) const;
+
+  int size() const { return int(count); }
+
+protected:
+  struct cHeader
+  {
+    char magic[8];
+    std::uint32_t count;
+  };
+
+  struct cEntry
+  {
+    std::uint32_t scopeOff, scopeLen, nameOff, nameLen, slot;
+  };
+
+  std::string_view text(std::uint32_t off, std::uint32_t len) const;
+  const cEntry& entry(std::uint32_t i) const;
+  void reset(); // unmap the file, the index becomes empty
+
+protected:
+  const char* data = nullptr;
+  std::size_t length = 0;
+  std::uint32_t count = 0;
+  std::vector<char> buffer; // file content if it isn't mapped
+
+private:
+  cRegistryIndex(const cRegistryIndex&) = delete;
+  cRegistryIndex& operator=(const cRegistryIndex&) = delete;
+};
+
+// NUMA topology of the host.
+// Nodes and their CPUs are read from /sys/devices/system/node on Linux. Without it (or on
+// other systems) there is one node with every CPU.
+class cNumaTopology
+{
+public:
+  explicit cNumaTopology(const std::string& sysfsNodeDir = "/sys/devices/system/node");
+
+  static const cNumaTopology& Get(); // topology of this host, read once
+
+  int NodeCount() const { return int(nodeCpus.size()); }
+  const std::vector<int>& Cpus(int node) const { return nodeCpus.at(node); }
+  int NodeOfCpu(int cpu) const;
+  int CurrentNode() const;           // node of the CPU running the calling thread
+
+  // bind the calling thread to CPUs of the node. false if it isn't possible.
+  bool PinThread(int node) const;
+
+  // allocate memory of the calling thread on the node when possible. false if it isn't supported.
+  bool PreferNode(int node) const;
+
+protected:
+  std::vector<std::vector<int>> nodeCpus; // node -> CPUs
+  std::vector<int> cpuNode;               // CPU -> node
+};
+
+// Read-only copies of factories, one per NUMA node (see cIoC::EnableReplication).
+// Every node has a long-lived builder thread bound to the node's CPUs and preferring the node's
+// memory, so the copies (and the slots publishing them) are allocated on the node. Readers take
+// the copy of their node by a plain acquire load within a cReader scope, which only writes an
+// epoch to the thread's own cache line (no read-modify-write; the store-load fence is moved to
+// the publisher by membarrier where Linux supports it). Replaced copies are freed by the
+// publishing thread when no reader can hold them any more.
+class cReplicas
+{
+public:
+  using tFactories = std::map<std::string, cFactory>;
+
+  cReplicas();   // starts a builder per node
+  ~cReplicas();  // there must be no readers
+
+  // copy factories to every node in parallel and publish the copies. One publisher at a time.
+  void Publish(const tFactories& factories);
+
+  int Count() const { return int(slots.size()); }
+
+  // scope of reading the copy of the calling thread's node
+  class cReader
+  {
+  public:
+    explicit cReader(const cReplicas& replicas);
+    ~cReader();
+
+    const tFactories& Factories() const { return *factories; }
+
+  private:
+    cReader(const cReader&) = delete;
+    cReader& operator=(const cReader&) = delete;
+
+    const tFactories* factories;
+  };
+
+protected:
+  struct alignas(64) cSlot
+  {
+    std::atomic<const tFactories*> current{ nullptr };
+  };
+
+  struct cNode; // builder thread of a node
+
+  struct cRetired
+  {
+    const tFactories* factories;
+    std::uint64_t epoch; // readers announced at this epoch or earlier may hold it
+  };
+
+  void reclaim();
+
+protected:
+  std::vector<std::unique_ptr<cNode>> nodes;
+  std::vector<cSlot*> slots;      // node -> slot allocated by the node's builder
+  std::vector<cRetired> retired;
+  const bool membarrier;          // the publisher fences readers, see reclaim
+
+private:
+  cReplicas(const cReplicas&) = delete;
+  cReplicas& operator=(const cReplicas&) = delete;
 };
 
 // cIoC is a container class for a factory pattern.  
@@ -129,16 +554,47 @@ protected:
 // If the first parameter is not "Register", the function looks for a factory method by scope  
 // and object name. The following parameters are passed to the factory method. Example:  
 // auto objPointer = t.Resolve<ObjType>("ScopeName", "get int for me", 42, "example");  
+// A precomputed registry index (see cRegistryIndex) may be attached by AttachIndex. Factory  
+// methods missing in registered factories are looked up in the index. A factory registered  
+// for a scope replaces the scope of the index as well, a factory method registered alone is  
+// added to it. SaveIndex writes registered factories together with the attached index.  
+// Memoize returns a command setting a memoization policy of a registered factory method.  
+// Results of the method are cached by argument values (see cMemoCache for ownership of them),  
+// repeated resolving with the same arguments returns the cached result without calling the  
+// method. Registering the method again drops its cached results:  
+// t.Memoize("ScopeName", "get int for me", cMemoPolicy{})->Execute();  
+// EnableReplication keeps a read-only copy of the factories per NUMA node (see cReplicas).  
+// Threads resolve from the copy of their node without touching the factories. Every executed  
+// registration rebuilds the copies. DeferReplicas postpones it to PublishReplicas, which  
+// rebuilds them once for all registrations made before it. A cCommandExecutor does so for  
+// its batches if it's given the both:  
+// cCommandExecutor e(64, [&t] { t.PublishReplicas(); }, [&t] { t.DeferReplicas(); });  
+// Replication must be switched before the container is shared between threads.  
 // Invalid parameters (e.g., registering a non-factory or non-factory method) will throw an exception.  
 // If no factory method is found for the given parameters, an exception is also thrown.  
+// ResolveAsync has the same parameters as Resolve but runs the factory method on an executor  
+// (see SetExecutor) and returns std::shared_future<T*>. Errors of the lookup, of the executor  
+// or of the factory method are delivered through the future. The default executor is a  
+// cThreadPool of the container started by the first request, the container waits for the  
+// rest of its tasks when it's destroyed. Requests for the  
+// same factory method without arguments (singleton-like objects) are coalesced while one of  
+// them is in flight: every caller gets the same future and the method is called once.  
+// auto fut = t.ResolveAsync<ObjType>("ScopeName", "get config");  
+// ObjType *obj = fut.get();  
 
 class cIoC
 {
+public:
+  // executor used by ResolveAsync. It takes a task and must run it exactly once.
+  using tExecutor = std::function<void(std::function<void()>)>;
+  using tFactories = std::map<std::string, cFactory>;
+
   // class 
 protected:
 
   friend struct iRegisterFactory;
   friend struct iRegisterFactoryMethod;
+  friend struct iRegisterMemoization;
 
 private:
   cIoC(const cIoC&) = delete;
@@ -149,14 +605,50 @@ protected:
   ~cIoC() = default;
 
 protected:
+  // memo gets the memoization cache of the method if it is requested
   template< typename T, typename... Args>
-  void* getMethod(const std::string& scope, const std::string& objName)
+  void* getMethod(const std::string& scope, const std::string& objName, std::shared_ptr<cMemoCache>* memo = nullptr)
+  {
+    // threads resolve from the replica of their node if the factories are replicated
+    if (replicas)
+    {
+      cReplicas::cReader reader(*replicas);
+      return findMethod<T, Args...>(reader.Factories(), scope, objName, memo);
+    }
+    return findMethod<T, Args...>(factories, scope, objName, memo);
+  }
+
+  template< typename T, typename... Args>
+  void* findMethod(const tFactories& fs, const std::string& scope, const std::string& objName, 
+    std::shared_ptr<cMemoCache>* memo) const
   {
     // find scope factory
-    auto factoryIt = factories.find(scope);
-    if (factoryIt == factories.end())
+    auto factoryIt = fs.find(scope);
+
+    // registered factory methods override the precomputed index, registered factories replace its scope
+    if (index != nullptr && (factoryIt == fs.end() 
+      || (!factoryIt->second.replacesIndex() && !factoryIt->second.contains(objName))))
+    {
+      bool scopeFound = false;
+      int slot = index->Find(scope, objName, &scopeFound);
+      if (slot >= 0)
+      {
+        if (std::size_t(slot) >= indexSlots.size())
+          throw cException("Wrong slot in registry index.");
+        if (memo != nullptr && factoryIt != fs.end())
+          *memo = factoryIt->second.getMemo(objName);
+        return const_cast<void*>(indexSlots[slot]);
+      }
+      if (factoryIt == fs.end() && scopeFound)
+        throw cException("There isn't such factory method.");
+    }
+
+    if (factoryIt == fs.end())
       throw cException("There isn't such factory.");
-    return reinterpret_cast<void*>(factoryIt->second.getFactoryMethod<T, Args...>(objName));
+    void* res = reinterpret_cast<void*>(factoryIt->second.getFactoryMethod<T, Args...>(objName));
+    if (memo != nullptr)
+      *memo = factoryIt->second.getMemo(objName);
+    return res;
   }
 
   template< typename R, typename... Args>
@@ -176,11 +668,177 @@ protected:
   template< typename T, typename... Args>
   T* doResolve(const std::string s1, const std::string s2, Args... args)
   {
-    auto method = getMethod<T, Args... >(s1, s2);
+    std::shared_ptr<cMemoCache> memo;
+    auto method = getMethod<T, Args... >(s1, s2, &memo);
     using f = T * (*)(Args...);
+
+    if (memo)
+      return memoResolve(*memo, f(method), args...);
+
     return (*f(method))(args...);
   }
 
+  template< typename T, typename... Args>
+  static T* memoResolve(cMemoCache& memo, T* (*method)(Args...), const Args&... args)
+  {
+    if constexpr ((... && cIsMemoizable<std::decay_t<Args>>::value))
+      return memo.Resolve(method, args...);
+    else
+      throw cException("Arguments can't be memoized.");
+  }
+
+  template< typename T, typename... Args>
+  std::shared_future<T*> doResolveAsync(const std::string s1, const std::string s2, Args... args)
+  {
+    using f = T * (*)(Args...);
+    auto promise = std::make_shared<std::promise<T*>>();
+    std::shared_future<T*> res = promise->get_future().share();
+
+    // look up the method in the caller thread, so factories are never touched by the executor
+    f method;
+    std::shared_ptr<cMemoCache> memo;
+    try
+    {
+      method = f(getMethod<T, Args... >(s1, s2, &memo));
+    }
+    catch (...)
+    {
+      promise->set_exception(std::current_exception());
+      return res;
+    }
+
+    auto state = asyncState;
+    std::shared_ptr<cInFlightKey> key;
+    std::unique_lock<std::mutex> lk(state->m);
+    if constexpr (sizeof...(Args) == 0)
+    {
+      // coalesce requests for the same in-flight object
+      std::string k = s1 + '\0' + s2 + '\0' + typeid(f).name();
+      auto it = state->inFlight.find(k);
+      if (it != state->inFlight.end())
+        return std::any_cast<std::shared_future<T*>>(it->second);
+      state->inFlight[k] = res;
+      key = std::make_shared<cInFlightKey>(state, std::move(k));
+    }
+    tExecutor executor = state->executor;
+    if (!executor && !pool)
+      pool = std::make_unique<cThreadPool>();
+    cThreadPool* defaultPool = pool.get();
+    lk.unlock();
+
+    // a dropped task releases the key too, its future gets broken_promise
+    std::function<void()> task = [key, method, memo, promise, args...]()
+      {
+        try
+        {
+          promise->set_value(memo ? memoResolve(*memo, method, args...) : method(args...));
+        }
+        catch (...)
+        {
+          try
+          {
+            promise->set_exception(std::current_exception());
+          }
+          catch (const std::future_error&) // the executor has failed after keeping the task
+          {
+          }
+        }
+
+        if (key)
+          key->Release();
+      };
+
+    try
+    {
+      if (executor)
+        executor(std::move(task));
+      else
+        defaultPool->Run(std::move(task));
+    }
+    catch (...)
+    {
+      if (key)
+        key->Release();
+      try
+      {
+        promise->set_exception(std::current_exception());
+      }
+      catch (const std::future_error&) // the task has been run before the executor failed
+      {
+      }
+    }
+
+    return res;
+  }
+
+  void doSaveIndex(const std::string& path, const std::vector<const void*>& slots) const
+  {
+    if (index == nullptr)
+      return cRegistryIndex::Save(path, factories, slots);
+
+    // entries of the attached index which aren't overridden are saved too
+    tFactories merged = factories;
+    index->ForEach([&](std::string_view scope, std::string_view objName, int slot)
+      {
+        auto it = factories.find(std::string(scope));
+        if (it != factories.end() && (it->second.replacesIndex() || it->second.contains(std::string(objName))))
+          return;
+        if (std::size_t(slot) >= indexSlots.size())
+          throw cException("Wrong slot in registry index.");
+        merged[std::string(scope)].doRegister(std::string(objName), indexSlots[slot]);
+      });
+    cRegistryIndex::Save(path, merged, slots);
+  }
+
+  void doAttachIndex(std::shared_ptr<const cRegistryIndex> idx, std::vector<const void*> slots)
+  {
+    index = std::move(idx);
+    indexSlots = std::move(slots);
+  }
+
+  void doEnableReplication(bool enable)
+  {
+    // the copies are used once they are published
+    std::unique_ptr<cReplicas> enabled;
+    if (enable)
+    {
+      enabled = std::make_unique<cReplicas>();
+      enabled->Publish(factories);
+    }
+    replicas = std::move(enabled);
+    replicasStale = false;
+    replicasDeferred = false;
+  }
+
+  void doPublishReplicas()
+  {
+    replicasDeferred = false;
+    if (replicas && replicasStale)
+      replicas->Publish(factories);
+    replicasStale = false;
+  }
+
+  // keep a cache dropped by a command if callers may hold its results
+  void retireMemo(const std::shared_ptr<cMemoCache>& cache)
+  {
+    if (cache && cache->Policy().ownsResults)
+      retiredMemo.push_back(cache);
+  }
+
+  // called by commands after they have changed factories
+  void replicasChanged()
+  {
+    replicasStale = true;
+    if (!replicasDeferred)
+      doPublishReplicas();
+  }
+
+  void doSetExecutor(tExecutor executor)
+  {
+    std::lock_guard<std::mutex> lk(asyncState->m);
+    asyncState->executor = std::move(executor);
+  }
+
   template< typename T, typename... Args>
   T* ssResolve(const std::string s1, const std::string s2, const Args... args)
   {
@@ -206,8 +864,43 @@ protected:
     return doResolve<T, Args...>(s1, s2, std::forward<const Args>(args)...);
   }
 
+protected:
+  // state shared with tasks of ResolveAsync, so the tasks don't refer to the container itself.
+  struct cAsyncState
+  {
+    std::mutex m;
+    std::map<std::string, std::any> inFlight; // key -> std::shared_future<T*>
+    tExecutor executor;                       // empty means the pool of the container
+  };
+
+  // key of a coalesced request, removed from inFlight once: by the task or when the task is dropped
+  struct cInFlightKey
+  {
+    cInFlightKey(std::shared_ptr<cAsyncState> state, std::string key) : state(std::move(state)), key(std::move(key)) {}
+    ~cInFlightKey() { Release(); }
+
+    void Release()
+    {
+      std::lock_guard<std::mutex> lk(state->m);
+      if (!key.empty())
+        state->inFlight.erase(key);
+      key.clear();
+    }
+
+    std::shared_ptr<cAsyncState> state;
+    std::string key;
+  };
+
 protected:
   std::map<std::string, cFactory> factories;
+  std::shared_ptr<cAsyncState> asyncState = std::make_shared<cAsyncState>();
+  std::shared_ptr<const cRegistryIndex> index;  // precomputed index, may be empty
+  std::vector<const void*> indexSlots;          // slot number -> factory method
+  std::unique_ptr<cReplicas> replicas;          // copies of factories per node, empty if not replicated
+  bool replicasStale = false;                   // factories changed after the last publication
+  bool replicasDeferred = false;                // registrations don't publish until PublishReplicas
+  std::vector<std::shared_ptr<cMemoCache>> retiredMemo; // dropped caches owning results
+  std::unique_ptr<cThreadPool> pool;            // default executor, declared last to join its tasks first
 };
 
 class IoC : public cIoC
@@ -222,6 +915,50 @@ public:
     return ssResolve<T>(std::string(s1), std::string(s2), std::forward<Args>(args)...);
   }
 
+  template< typename T, typename S1, typename S2, typename... Args>
+  std::shared_future<T*> ResolveAsync(S1 s1, S2 s2, Args... args)
+  {
+    return doResolveAsync<T>(std::string(s1), std::string(s2), std::forward<Args>(args)...);
+  }
+
+  // write layout of registered factories and of the attached index to a file. 
+  // slots[i] is a factory method of slot i.
+  void SaveIndex(const std::string& path, const std::vector<const void*>& slots) const
+  {
+    doSaveIndex(path, slots);
+  }
+
+  // attach a precomputed index, slots must be the same table as used by SaveIndex.
+  void AttachIndex(std::shared_ptr<const cRegistryIndex> index, std::vector<const void*> slots)
+  {
+    doAttachIndex(std::move(index), std::move(slots));
+  }
+
+  // command to memoize results of a factory method
+  iCommand* Memoize(const std::string& scope, const std::string& objName, const cMemoPolicy& policy)
+  {
+    return new iRegisterMemoization(*this, scope, objName, policy);
+  }
+
+  // cache of a memoized factory method or nullptr. Call it from the registering thread.
+  std::shared_ptr<const cMemoCache> MemoCache(const std::string& scope, const std::string& objName) const
+  {
+    auto it = factories.find(scope);
+    return it == factories.end() ? nullptr : it->second.getMemo(objName);
+  }
+
+  // keep a copy of the factories per NUMA node. Switch it before sharing the container.
+  void EnableReplication(bool enable = true) { doEnableReplication(enable); }
+
+  // rebuild copies of the factories after deferred registrations. Call it from the registering thread.
+  void PublishReplicas() { doPublishReplicas(); }
+
+  // don't rebuild copies of the factories on registrations until PublishReplicas
+  void DeferReplicas() { replicasDeferred = true; }
+
+  // set executor for ResolveAsync. Empty executor means a pool of hardware_concurrency threads.
+  void SetExecutor(tExecutor executor) { doSetExecutor(std::move(executor)); }
+
 };
 
 template<>
@@ -235,18 +972,54 @@ inline iRegisterFactory::iRegisterFactory(cIoC& ioc, const std::string& scope, c
 
 inline void iRegisterFactory::Execute()
 {
-  ioc->factories[scope] = *f;
+  auto old = ioc->factories.find(scope);
+  if (old != ioc->factories.end())
+    for (const auto& m : old->second.memo)
+      ioc->retireMemo(m.second);
+
+  cFactory& registered = ioc->factories[scope] = *f;
+  registered.wholeScope = true;
+  ioc->replicasChanged();
 }
 
 inline void iRegisterFactoryMethod::Execute()
 {
-  if (ioc->factories.find(scope) == ioc->factories.end())
+  bool scopeFound = false;
+  if (ioc->index != nullptr)
+    ioc->index->Find(scope, objName, &scopeFound);
+
+  if (!scopeFound && ioc->factories.find(scope) == ioc->factories.end())
     throw cException("There isn't such factory.");
 
   auto& m = ioc->factories[scope];
+  ioc->retireMemo(m.getMemo(objName));
   m.doRegister(objName, f);
+  ioc->replicasChanged();
 }
 
+inline void iRegisterMemoization::Execute()
+{
+  // the method is registered or is in the index of a scope not replaced by a factory
+  auto it = ioc->factories.find(scope);
+  bool scopeFound = it != ioc->factories.end();
+  bool methodFound = scopeFound && it->second.contains(objName);
+  if (!methodFound && ioc->index != nullptr && (!scopeFound || !it->second.replacesIndex()))
+  {
+    bool indexScopeFound = false;
+    methodFound = ioc->index->Find(scope, objName, &indexScopeFound) >= 0;
+    scopeFound = scopeFound || indexScopeFound;
+  }
+
+  if (!scopeFound)
+    throw cException("There isn't such factory.");
+  if (!methodFound)
+    throw cException("There isn't such factory method.");
+
+  auto& m = ioc->factories[scope];
+  ioc->retireMemo(m.getMemo(objName));
+  m.doMemoize(objName, policy);
+  ioc->replicasChanged();
+}
 
 #endif //#ifndef IOC_HPP
 
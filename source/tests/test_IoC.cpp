@@ -5,6 +5,8 @@
 #include "ioc.hpp"
 #include <optional>
 #include <thread>
+#include <filesystem>
+#include <fstream>
 
 // clang-format off
 
@@ -385,6 +387,9 @@ public:
   public:
     // add here members for free access.
     using IoC::IoC; // delegate constructors
+    using IoC::getMethod;
+    using IoC::factories;
+    using IoC::replicas;
   };
 };
 
@@ -408,6 +413,559 @@ TEST_F(test_IoC, test_Resolve)
   double* m4 = t.Resolve<double>("A", "int3", std::string("256"), 333, &f1);
 }
 
+int resolveAsyncCalls = 0;
+
+TEST_F(test_IoC, test_ResolveAsync)
+{
+  Test_IoC t;
+
+  struct cTmp
+  {
+    static int* Slow()
+    {
+      ++resolveAsyncCalls;
+      return &test_cFactory::Test_cFactory::resGetInt;
+    }
+  };
+
+  test_cFactory::Test_cFactory f1;
+  f1.Register("int3", test_cFactory::Test_cFactory::GetInt3);
+  f1.Register("slow", cTmp::Slow);
+
+  const cFactory& f11 = f1;
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11))->Execute();
+
+  // default executor: the pool of the container
+  auto r1 = t.ResolveAsync<int>("A", "int3", std::string("256"));
+  EXPECT_EQ(256, *r1.get());
+
+  // deferred executor: keep tasks and run them later
+  std::vector<std::function<void()>> tasks;
+  t.SetExecutor([&tasks](std::function<void()> task) { tasks.push_back(std::move(task)); });
+
+  // requests for the same in-flight object are coalesced
+  resolveAsyncCalls = 0;
+  auto r2 = t.ResolveAsync<int>("A", "slow");
+  auto r3 = t.ResolveAsync<int>("A", "slow");
+  EXPECT_EQ(1, tasks.size());
+  for (auto& task : tasks)
+    task();
+  tasks.clear();
+  EXPECT_EQ(&test_cFactory::Test_cFactory::resGetInt, r2.get());
+  EXPECT_EQ(&test_cFactory::Test_cFactory::resGetInt, r3.get());
+  EXPECT_EQ(1, resolveAsyncCalls);
+
+  // finished request isn't in flight any more
+  auto r4 = t.ResolveAsync<int>("A", "slow");
+  EXPECT_EQ(1, tasks.size());
+  tasks[0]();
+  EXPECT_EQ(&test_cFactory::Test_cFactory::resGetInt, r4.get());
+  EXPECT_EQ(2, resolveAsyncCalls);
+
+  // executor fails: the error goes to the future, the request isn't in flight any more
+  t.SetExecutor([](std::function<void()>) { throw cException("Executor failed."); });
+  auto r6 = t.ResolveAsync<int>("A", "slow");
+  try
+  {
+    r6.get();
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("Executor failed.", expected.what());
+  }
+
+  // executor keeps the task and fails, the task is run later: the future keeps the executor's error
+  tasks.clear();
+  t.SetExecutor([&tasks](std::function<void()> task) { tasks.push_back(std::move(task)); throw cException("Executor failed."); });
+  auto r8 = t.ResolveAsync<int>("A", "slow");
+  ASSERT_EQ(1, tasks.size());
+  tasks[0]();
+  tasks.clear();
+  EXPECT_THROW(r8.get(), cException);
+  EXPECT_EQ(3, resolveAsyncCalls);
+
+  // executor drops the task
+  t.SetExecutor([](std::function<void()>) {});
+  auto r7 = t.ResolveAsync<int>("A", "slow");
+  EXPECT_THROW(r7.get(), std::future_error);
+
+  t.SetExecutor([](std::function<void()> task) { task(); });
+  EXPECT_EQ(&test_cFactory::Test_cFactory::resGetInt, t.ResolveAsync<int>("A", "slow").get());
+  EXPECT_EQ(4, resolveAsyncCalls);
+
+  // errors are delivered through the future
+  auto r5 = t.ResolveAsync<int>("B", "slow");
+  try
+  {
+    r5.get();
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory.", expected.what());
+  }
+}
+
+TEST_F(test_IoC, test_RegistryIndex)
+{
+  const std::string path = (std::filesystem::temp_directory_path() / "test_IoC_registry.idx").string();
+
+  // function pointer table of the binary
+  const std::vector<const void*> slots = {
+    (const void*)test_cFactory::Test_cFactory::GetInt,
+    (const void*)test_cFactory::Test_cFactory::GetInt2,
+    (const void*)test_cFactory::Test_cFactory::GetInt3,
+  };
+
+  {
+    Test_IoC t;
+    test_cFactory::Test_cFactory f1, f2;
+    f1.Register("int", test_cFactory::Test_cFactory::GetInt);
+    f1.Register("int3", test_cFactory::Test_cFactory::GetInt3);
+    f2.Register("int", test_cFactory::Test_cFactory::GetInt2);
+
+    const cFactory& f11 = f1;
+    const cFactory& f22 = f2;
+    std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11))->Execute();
+    std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "B", f22))->Execute();
+    t.SaveIndex(path, slots);
+
+    // method isn't in the slot table
+    std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "B", "clone", test_cFactory::Test_cFactory::Clone))->Execute();
+    try
+    {
+      t.SaveIndex(path + ".bad", slots);
+      FAIL();
+    }
+    catch (const std::exception& expected)
+    {
+      ASSERT_STREQ("There isn't such factory method in the slot table.", expected.what());
+    }
+  }
+
+  auto index = std::make_shared<cRegistryIndex>();
+  index->Open(path);
+  EXPECT_EQ(3, index->size());
+  EXPECT_EQ(2, index->Find("A", "int3"));
+  EXPECT_EQ(1, index->Find("B", "int"));
+  EXPECT_EQ(-1, index->Find("B", "int3"));
+
+  Test_IoC t;
+  t.AttachIndex(index, slots);
+
+  int* m1 = t.Resolve<int>("A", "int3", std::string("256"));
+  EXPECT_EQ(256, *m1);
+  auto m2 = t.getMethod<int>("B", "int");
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt2, m2);
+
+  // registered factory methods override the index
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "B", "int", test_cFactory::Test_cFactory::GetInt))->Execute();
+  auto m3 = t.getMethod<int>("B", "int");
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, m3);
+  auto m4 = t.getMethod<int>("A", "int");
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, m4);
+
+  // no such factory method
+  try
+  {
+    t.getMethod<int>("A", "int99");
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory method.", expected.what());
+  }
+
+  // no such factory
+  try
+  {
+    t.getMethod<int>("C", "int");
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory.", expected.what());
+  }
+
+  // memoizing a factory method of the index
+  std::unique_ptr<iCommand>(t.Memoize("A", "int3", cMemoPolicy{}))->Execute();
+  EXPECT_EQ(m1, t.Resolve<int>("A", "int3", std::string("256")));
+  EXPECT_EQ(m1, t.Resolve<int>("A", "int3", std::string("256")));
+  EXPECT_EQ(1, t.MemoCache("A", "int3")->Hits());
+  try
+  {
+    std::unique_ptr<iCommand>(t.Memoize("C", "int", cMemoPolicy{}))->Execute();
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory.", expected.what());
+  }
+
+  // saving keeps entries of the attached index which aren't overridden
+  t.SaveIndex(path + ".merged", slots);
+  cRegistryIndex merged;
+  merged.Open(path + ".merged");
+  EXPECT_EQ(3, merged.size());
+  EXPECT_EQ(0, merged.Find("A", "int"));
+  EXPECT_EQ(2, merged.Find("A", "int3"));
+  EXPECT_EQ(0, merged.Find("B", "int"));
+
+  // a registered factory replaces the scope of the index
+  test_cFactory::Test_cFactory f3;
+  f3.Register("int", test_cFactory::Test_cFactory::GetInt2);
+  const cFactory& f33 = f3;
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f33))->Execute();
+  auto m5 = t.getMethod<int>("A", "int");
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt2, m5);
+  try
+  {
+    t.getMethod<int, std::string>("A", "int3");
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory method.", expected.what());
+  }
+  t.SaveIndex(path + ".merged", slots);
+  merged.Open(path + ".merged");
+  EXPECT_EQ(2, merged.size());
+  EXPECT_EQ(1, merged.Find("A", "int"));
+  EXPECT_EQ(-1, merged.Find("A", "int3"));
+
+  // reopening replaces the mapping
+  cRegistryIndex reopened;
+  reopened.Open(path);
+  reopened.Open(path);
+  EXPECT_EQ(3, reopened.size());
+  EXPECT_EQ(2, reopened.Find("A", "int3"));
+
+  // not an index
+  std::ofstream(path + ".bad") << "not an index, just a text file";
+  try
+  {
+    reopened.Open(path + ".bad");
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("Wrong registry index.", expected.what());
+  }
+  EXPECT_EQ(0, reopened.size());
+  EXPECT_EQ(-1, reopened.Find("A", "int3"));
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(path + ".bad");
+  std::filesystem::remove(path + ".merged");
+}
+
+TEST_F(test_IoC, test_CommandExecutor)
+{
+  enum { PRODUCERS = 4, COMMANDS = 250 };
+
+  Test_IoC t;
+  cCommandExecutor e(16);
+
+  test_cFactory::Test_cFactory f1;
+  f1.Register("int", test_cFactory::Test_cFactory::GetInt);
+  const cFactory& f11 = f1;
+  auto registered = e.Push(std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11)));
+
+  std::vector<std::thread> producers;
+  for (int i = 0; i < PRODUCERS; ++i)
+  {
+    producers.emplace_back([&t, &e, i]()
+      {
+        for (int j = 0; j < COMMANDS; ++j)
+        {
+          std::string name = std::to_string(i) + "_" + std::to_string(j);
+          e.Push(std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", name, test_cFactory::Test_cFactory::GetInt3)));
+        }
+      });
+  }
+
+  // resolve concurrently with registrations
+  registered.get();
+  {
+    auto lock = e.ReadLock();
+    auto m1 = t.getMethod<int>("A", "int");
+    EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, m1);
+  }
+
+  for (auto& p : producers)
+    p.join();
+  e.Flush();
+
+  {
+    auto lock = e.ReadLock();
+    EXPECT_EQ(PRODUCERS * COMMANDS + 1, t.factories["A"].size());
+    int* m2 = t.Resolve<int>("A", "3_249", std::string("256"));
+    EXPECT_EQ(256, *m2);
+  }
+
+  // errors are delivered through the future
+  auto res = e.Push(std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "B", "int3", test_cFactory::Test_cFactory::GetInt3)));
+  try
+  {
+    res.get();
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory.", expected.what());
+  }
+}
+
+TEST_F(test_IoC, test_NumaTopology)
+{
+  // fake sysfs
+  const auto dir = std::filesystem::temp_directory_path() / "test_IoC_node";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "node0");
+  std::filesystem::create_directories(dir / "node1");
+  std::filesystem::create_directories(dir / "power");
+  std::ofstream(dir / "node0" / "cpulist") << "0-1,4\n";
+  std::ofstream(dir / "node1" / "cpulist") << "2-3,5\n";
+  std::ofstream(dir / "possible") << "0-1\n";
+
+  cNumaTopology t(dir.string());
+  EXPECT_EQ(2, t.NodeCount());
+  EXPECT_EQ(std::vector<int>({ 0, 1, 4 }), t.Cpus(0));
+  EXPECT_EQ(std::vector<int>({ 2, 3, 5 }), t.Cpus(1));
+  EXPECT_EQ(0, t.NodeOfCpu(4));
+  EXPECT_EQ(1, t.NodeOfCpu(3));
+  EXPECT_EQ(0, t.NodeOfCpu(99));
+
+  // no NUMA information
+  cNumaTopology t1((dir / "power").string());
+  EXPECT_EQ(1, t1.NodeCount());
+  EXPECT_FALSE(t1.Cpus(0).empty());
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_F(test_IoC, test_EnableReplication)
+{
+  Test_IoC t;
+
+  test_cFactory::Test_cFactory f1;
+  f1.Register("int", test_cFactory::Test_cFactory::GetInt);
+  const cFactory& f11 = f1;
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11))->Execute();
+
+  t.EnableReplication();
+  EXPECT_EQ(cNumaTopology::Get().NodeCount(), t.replicas->Count());
+
+  // executed registrations are visible at once
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "int3", test_cFactory::Test_cFactory::GetInt3))->Execute();
+  int* m1 = t.Resolve<int>("A", "int3", std::string("256"));
+  EXPECT_EQ(256, *m1);
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, t.getMethod<int>("A", "int"));
+
+  // re-registration too
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "int", test_cFactory::Test_cFactory::GetInt2))->Execute();
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt2, t.getMethod<int>("A", "int"));
+
+  // deferred registrations are visible after publication
+  t.DeferReplicas();
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "int", test_cFactory::Test_cFactory::GetInt))->Execute();
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt2, t.getMethod<int>("A", "int"));
+  t.PublishReplicas();
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, t.getMethod<int>("A", "int"));
+
+  // registrations by an executor are published once per batches
+  {
+    cCommandExecutor e(64, [&t] { t.PublishReplicas(); }, [&t] { t.DeferReplicas(); });
+    std::vector<std::future<void>> done;
+    for (int i = 0; i < 100; ++i)
+      done.push_back(e.Push(std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "n" + std::to_string(i), test_cFactory::Test_cFactory::GetInt3))));
+    done.back().get();
+
+    // read without the executor's lock
+    std::thread reader([&t]()
+      {
+        int* m2 = t.Resolve<int>("A", "n99", std::string("7"));
+        EXPECT_EQ(7, *m2);
+      });
+    reader.join();
+  }
+
+  // resolving from other threads
+  std::vector<std::thread> threads;
+  std::atomic<int> found{ 0 };
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back([&t, &found]()
+      {
+        if (t.getMethod<int>("A", "int") == (const void*)test_cFactory::Test_cFactory::GetInt)
+          ++found;
+      });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(4, found);
+
+  t.EnableReplication(false);
+  EXPECT_EQ(nullptr, t.replicas);
+  EXPECT_EQ((const void*)test_cFactory::Test_cFactory::GetInt, t.getMethod<int>("A", "int"));
+}
+
+// argument of a memoized factory method with own hash
+struct cMemoPoint
+{
+  int x, y;
+  bool operator==(const cMemoPoint& o) const { return x == o.x && y == o.y; }
+};
+
+template<>
+struct cMemoHash<cMemoPoint>
+{
+  std::size_t operator()(const cMemoPoint& p) const { return std::size_t(p.x) * 31 + std::size_t(p.y); }
+};
+
+// argument without a hash
+struct cNotHashable
+{
+  int x;
+};
+
+int memoCalls = 0;
+
+TEST_F(test_IoC, test_Memoize)
+{
+  struct cTmp
+  {
+    static int* Parse(std::string s)
+    {
+      ++memoCalls;
+      return new int(std::stoi(s));
+    }
+    static int* Sum(cMemoPoint p)
+    {
+      ++memoCalls;
+      return new int(p.x + p.y);
+    }
+    static int* Wrong(cNotHashable) { return nullptr; }
+  };
+
+  Test_IoC t;
+  test_cFactory::Test_cFactory f1;
+  f1.Register("parse", cTmp::Parse);
+  f1.Register("sum", cTmp::Sum);
+  f1.Register("wrong", cTmp::Wrong);
+  f1.Register("int3", test_cFactory::Test_cFactory::GetInt3);
+  const cFactory& f11 = f1;
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11))->Execute();
+
+  cMemoPolicy policy;
+  policy.maxEntries = 2;
+  policy.shards = 1;
+  policy.ownsResults = true;
+  std::unique_ptr<iCommand>(t.Memoize("A", "parse", policy))->Execute();
+  std::unique_ptr<iCommand>(t.Memoize("A", "sum", policy))->Execute();
+  std::unique_ptr<iCommand>(t.Memoize("A", "wrong", policy))->Execute();
+  EXPECT_EQ(nullptr, t.MemoCache("A", "int3"));
+
+  // repeated arguments skip construction
+  memoCalls = 0;
+  int* p1 = t.Resolve<int>("A", "parse", std::string("1"));
+  int* p2 = t.Resolve<int>("A", "parse", std::string("2"));
+  int* p3 = t.Resolve<int>("A", "parse", std::string("1"));
+  EXPECT_EQ(1, *p1);
+  EXPECT_EQ(2, *p2);
+  EXPECT_EQ(p1, p3);
+  EXPECT_EQ(2, memoCalls);
+
+  auto cache = t.MemoCache("A", "parse");
+  EXPECT_EQ(1, cache->Hits());
+  EXPECT_EQ(2, cache->Misses());
+  EXPECT_EQ(0, cache->Evictions());
+
+  // "2" is the least recently used one
+  int* p4 = t.Resolve<int>("A", "parse", std::string("3"));
+  EXPECT_EQ(3, *p4);
+  EXPECT_EQ(1, cache->Evictions());
+  EXPECT_EQ(2, cache->Size());
+  EXPECT_EQ(p1, t.Resolve<int>("A", "parse", std::string("1")));
+  int* p5 = t.Resolve<int>("A", "parse", std::string("2"));
+  EXPECT_EQ(2, *p5);
+  EXPECT_EQ(4, memoCalls);
+  EXPECT_EQ(2, *p2); // evicted results are deleted with the cache
+
+  // own hash
+  int* s1 = t.Resolve<int>("A", "sum", cMemoPoint{ 1, 2 });
+  int* s2 = t.Resolve<int>("A", "sum", cMemoPoint{ 1, 2 });
+  int* s3 = t.Resolve<int>("A", "sum", cMemoPoint{ 2, 1 });
+  EXPECT_EQ(s1, s2);
+  EXPECT_EQ(3, *s3);
+  EXPECT_NE(s1, s3);
+  EXPECT_EQ(6, memoCalls);
+
+  // not memoized factory method
+  int* m1 = t.Resolve<int>("A", "int3", std::string("256"));
+  EXPECT_EQ(256, *m1);
+
+  try
+  {
+    t.Resolve<int>("A", "wrong", cNotHashable{ 1 });
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("Arguments can't be memoized.", expected.what());
+  }
+
+  // ResolveAsync uses the cache too
+  t.SetExecutor([](std::function<void()> task) { task(); });
+  EXPECT_EQ(p1, t.ResolveAsync<int>("A", "parse", std::string("1")).get());
+  EXPECT_EQ(6, memoCalls);
+
+  // registering the method again drops cached results
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "parse", cTmp::Sum))->Execute();
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", "parse", cTmp::Parse))->Execute();
+  EXPECT_EQ(0, t.MemoCache("A", "parse")->Size());
+  EXPECT_EQ(policy.maxEntries, t.MemoCache("A", "parse")->Policy().maxEntries);
+  t.Resolve<int>("A", "parse", std::string("1"));
+  EXPECT_EQ(7, memoCalls);
+  EXPECT_EQ(1, *p1); // results of the dropped cache are deleted with the container
+
+  // by default the factory method keeps ownership of results
+  std::unique_ptr<iCommand>(t.Memoize("A", "int3", cMemoPolicy{}))->Execute();
+  int* n1 = t.Resolve<int>("A", "int3", std::string("1"));
+  t.Resolve<int>("A", "int3", std::string("2"));
+  EXPECT_EQ(n1, t.Resolve<int>("A", "int3", std::string("1")));
+  EXPECT_EQ(1, t.MemoCache("A", "int3")->Hits());
+
+  // no such factory method
+  try
+  {
+    std::unique_ptr<iCommand>(t.Memoize("A", "int99", policy))->Execute();
+    FAIL();
+  }
+  catch (const std::exception& expected)
+  {
+    ASSERT_STREQ("There isn't such factory method.", expected.what());
+  }
+
+  // memory budget
+  cMemoPolicy small;
+  small.memoryBudget = 1;
+  small.shards = 1;
+  small.ownsResults = true;
+  std::unique_ptr<iCommand>(t.Memoize("A", "parse", small))->Execute();
+  t.Resolve<int>("A", "parse", std::string("1"));
+  t.Resolve<int>("A", "parse", std::string("2"));
+  EXPECT_EQ(1, t.MemoCache("A", "parse")->Size());
+  EXPECT_EQ(1, t.MemoCache("A", "parse")->Evictions());
+  EXPECT_LT(sizeof(int), t.MemoCache("A", "parse")->MemoryUsage());
+
+  // a whole factory replaces caches of the scope
+  std::unique_ptr<iCommand>(t.Resolve<iCommand>("Register", "A", f11))->Execute();
+  EXPECT_EQ(nullptr, t.MemoCache("A", "parse"));
+  EXPECT_EQ(1, *p1);
+}
+
 enum { RUN_COUNT = 10'000 };
 int cnt1 = 0, cnt2 = 0;
 